@@ -0,0 +1,401 @@
+//---------------------------------------------------------------------
+// Assignment : PA-04 Multi-Threaded UDP Server
+// Date       :
+// Author     : Joshua Cassada and Thomas Cantrell
+//
+// BENCHMARK: micro and end-to-end benchmarks for the factory code.
+// Results are printed one per line as
+//
+//     <name> <value> <unit> <higher|lower>
+//
+// where the last column says which direction is better, after a
+// "# cflags <flags>" line naming the build.  With -c the results are
+// also compared with a stored baseline in the same format; baselines
+// from a different build are refused.  Each benchmark has its own
+// tolerance ( tail latency is reported but never gated ), and the exit
+// status is 1 if anything got worse by more than its tolerance.
+// The comparison goes to stderr so stdout stays results only.
+//----------------------------------------------------------------------
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "wrappers.h"
+#include "message.h"
+#include "netio.h"
+
+#define MAXRESULTS      32
+#define CLAIM_THREADS    8
+#define CLAIM_PARTS  2000000
+#define RTT_ROUNDS    20000
+#define SEND_THREADS      8
+#define SEND_MSGS     20000   /* per thread */
+#define REPLY_TIMEOUT    5   /* seconds */
+#define NOT_GATED      (-1)
+
+#ifndef BUILD_CFLAGS
+#define BUILD_CFLAGS   ""
+#endif
+
+typedef struct sockaddr SA;
+
+typedef struct {
+    char   name[40], unit[16];
+    double value, tolerance;    /* percent, or NOT_GATED */
+    int    higherIsBetter;
+} benchResult;
+
+static benchResult results[MAXRESULTS];
+static int         numResults = 0;
+
+static void report(const char *name, double value, const char *unit, int higherIsBetter,
+                   double tolerance) {
+    benchResult *r = &results[numResults++];
+    snprintf(r->name, sizeof(r->name), "%s", name);
+    snprintf(r->unit, sizeof(r->unit), "%s", unit);
+    r->value = value;
+    r->tolerance = tolerance;
+    r->higherIsBetter = higherIsBetter;
+    printf("%s %.3f %s %s\n", name, value, unit, higherIsBetter ? "higher" : "lower");
+    fflush(stdout);
+}
+
+/*--------------------------------------------------------------------
+   Message encode / decode, done field by field as the servers do
+----------------------------------------------------------------------*/
+static void benchEncodeDecode(void) {
+    const int rounds = 10000000;
+    volatile unsigned sink = 0;
+    msgBuf msg;
+
+    double start = nowMs();
+    for (int i = 0; i < rounds; i++) {
+        msg.purpose   = htonl(PRODUCTION_MSG);
+        msg.facID     = htonl(i % MAXFACTORIES + 1);
+        msg.capacity  = htonl(50);
+        msg.partsMade = htonl(i & 63);
+        msg.duration  = htonl(i & 1023);
+        __asm__ __volatile__("" : : "r"(&msg) : "memory");
+        sink += ntohl(msg.purpose) + ntohl(msg.facID) + ntohl(msg.capacity)
+              + ntohl(msg.partsMade) + ntohl(msg.duration);
+    }
+    report("encode_decode", (nowMs() - start) * 1e6 / rounds, "ns/msg", 0, 35);
+}
+
+/*--------------------------------------------------------------------
+   Claiming parts from the remaining order: the orderMutex way the
+   sub-factories do it, and with a compare-and-swap loop
+----------------------------------------------------------------------*/
+static int             remaining;
+static pthread_mutex_t claimMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void* claimMutexThread(void* arg) {
+    int capacity = *(int *)arg, made = 0;
+
+    while (1) {
+        pthread_mutex_lock(&claimMutex);
+        if (remaining <= 0) {
+            pthread_mutex_unlock(&claimMutex);
+            break;
+        }
+        int toMake = (remaining < capacity) ? remaining : capacity;
+        remaining -= toMake;
+        pthread_mutex_unlock(&claimMutex);
+        made += toMake;
+    }
+    return (void *)(long) made;
+}
+
+static void* claimAtomicThread(void* arg) {
+    int capacity = *(int *)arg, made = 0;
+    int left = __atomic_load_n(&remaining, __ATOMIC_RELAXED);
+
+    while (left > 0) {
+        int toMake = (left < capacity) ? left : capacity;
+        if (__atomic_compare_exchange_n(&remaining, &left, left - toMake, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+            made += toMake;
+    }
+    return (void *)(long) made;
+}
+
+static void benchClaim(const char *name, void *(*claim)(void *)) {
+    pthread_t tid[CLAIM_THREADS];
+    int       capacity = 1;
+    long      made, total = 0;
+
+    remaining = CLAIM_PARTS;
+    double start = nowMs();
+    for (int i = 0; i < CLAIM_THREADS; i++)
+        Pthread_create(&tid[i], NULL, claim, &capacity);
+    for (int i = 0; i < CLAIM_THREADS; i++) {
+        Pthread_join(tid[i], (void **)&made);
+        total += made;
+    }
+    double sec = (nowMs() - start) / 1000.0;
+
+    if (total != CLAIM_PARTS)
+        err_quit("claim benchmark lost parts\n");
+    report(name, CLAIM_PARTS / sec / 1e6, "Mclaims/s", 1, 30);
+}
+
+/*--------------------------------------------------------------------
+   UDP round trip over the loopback interface
+----------------------------------------------------------------------*/
+static void* echoThread(void* arg) {
+    int sd = *(int *)arg;
+    struct sockaddr_in from;
+    socklen_t len;
+    msgBuf msg;
+
+    for (int i = 0; i < RTT_ROUNDS; i++) {
+        len = sizeof(from);
+        if (recvfrom(sd, &msg, sizeof(msg), 0, (SA*)&from, &len) < 0)
+            break;
+        sendto(sd, &msg, sizeof(msg), 0, (SA*)&from, len);
+    }
+    return NULL;
+}
+
+static int cmpDouble(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void benchLoopback(void) {
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    struct timeval tmo = { REPLY_TIMEOUT, 0 };
+    double *rtt = malloc(RTT_ROUNDS * sizeof(double));
+    pthread_t tid;
+    msgBuf msg;
+
+    int echo = socket(AF_INET, SOCK_DGRAM, 0);
+    int sd = socket(AF_INET, SOCK_DGRAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (echo < 0 || sd < 0 || rtt == NULL || bind(echo, (SA*)&addr, sizeof(addr)) < 0)
+        err_sys("loopback benchmark setup failed");
+    getsockname(echo, (SA*)&addr, &len);
+    setsockopt(sd, SOL_SOCKET, SO_RCVTIMEO, &tmo, sizeof(tmo));
+
+    Pthread_create(&tid, NULL, echoThread, &echo);
+    memset(&msg, 0, sizeof(msg));
+    for (int i = 0; i < RTT_ROUNDS; i++) {
+        double start = nowMs();
+        sendto(sd, &msg, sizeof(msg), 0, (SA*)&addr, sizeof(addr));
+        if (recv(sd, &msg, sizeof(msg), 0) < 0)
+            err_sys("loopback benchmark lost a reply");
+        rtt[i] = (nowMs() - start) * 1000.0;
+    }
+    Pthread_join(tid, NULL);
+    close(echo);
+    close(sd);
+
+    qsort(rtt, RTT_ROUNDS, sizeof(double), cmpDouble);
+    report("loopback_rtt_p50", rtt[RTT_ROUNDS / 2], "usec", 0, 30);
+    report("loopback_rtt_p99", rtt[RTT_ROUNDS * 99 / 100], "usec", 0, NOT_GATED);
+    free(rtt);
+}
+
+/*--------------------------------------------------------------------
+   The factory's send backends ( netio.c ), each fed by SEND_THREADS
+   sub-factory-like threads, into a loopback socket nobody reads.
+   The uring backend is skipped where the kernel does not offer it.
+----------------------------------------------------------------------*/
+static struct sockaddr_in sink;
+
+static void* sendThread(void* arg) {
+    msgBuf msg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.purpose = htonl(PRODUCTION_MSG);
+    for (int i = 0; i < SEND_MSGS; i++)
+        netSend(&msg, &sink);
+    return NULL;
+}
+
+static void benchBackend(const char *name, netBackend_t want) {
+    socklen_t len = sizeof(sink);
+    pthread_t tid[SEND_THREADS];
+
+    int sinkSd = socket(AF_INET, SOCK_DGRAM, 0);
+    int sd = socket(AF_INET, SOCK_DGRAM, 0);
+    memset(&sink, 0, sizeof(sink));
+    sink.sin_family = AF_INET;
+    sink.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (sinkSd < 0 || sd < 0 || bind(sinkSd, (SA*)&sink, sizeof(sink)) < 0)
+        err_sys("send benchmark setup failed");
+    getsockname(sinkSd, (SA*)&sink, &len);
+
+    if (netInit(sd, want) != want) {
+        fprintf(stderr, "%s: backend not available, skipped\n", name);
+        close(sinkSd);
+        close(sd);
+        return;
+    }
+
+    double start = nowMs();
+    for (int i = 0; i < SEND_THREADS; i++)
+        Pthread_create(&tid[i], NULL, sendThread, NULL);
+    for (int i = 0; i < SEND_THREADS; i++)
+        Pthread_join(tid[i], NULL);
+    netFlush();
+    double sec = (nowMs() - start) / 1000.0;
+
+    netShutdown();
+    close(sinkSd);
+    close(sd);
+    report(name, SEND_THREADS * SEND_MSGS / sec / 1e3, "Kmsgs/s", 1, 40);
+}
+
+/*--------------------------------------------------------------------
+   Whole orders against a running factory server.  Start it with a
+   large -x so the simulated production clock is not the bottleneck.
+----------------------------------------------------------------------*/
+static void benchOrders(const char *server, int orders, unsigned orderSize) {
+    struct sockaddr_in addr;
+    struct timeval tmo = { REPLY_TIMEOUT, 0 };
+    char ip[INET_ADDRSTRLEN] = "127.0.0.1";
+    const char *colon = strrchr(server, ':');
+    msgBuf msg;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    if (colon != NULL)
+        snprintf(ip, sizeof(ip), "%.*s", (int)(colon - server), server);
+    addr.sin_port = htons(atoi(colon ? colon + 1 : server));
+    if (inet_pton(AF_INET, ip, &addr.sin_addr) <= 0)
+        err_quit("Invalid factory server address\n");
+
+    int sd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sd < 0)
+        err_sys("socket failed");
+    setsockopt(sd, SOL_SOCKET, SO_RCVTIMEO, &tmo, sizeof(tmo));
+
+    double start = nowMs();
+    for (int i = 0; i < orders; i++) {
+        unsigned numFac = 0, done = 0, parts = 0;
+
+        memset(&msg, 0, sizeof(msg));
+        msg.purpose = htonl(REQUEST_MSG);
+        msg.orderSize = htonl(orderSize);
+        sendto(sd, &msg, sizeof(msg), 0, (SA*)&addr, sizeof(addr));
+
+        while (numFac == 0 || done < numFac) {
+            // A closed io_uring may still interrupt this thread once
+            if (recv(sd, &msg, sizeof(msg), 0) < 0) {
+                if (errno == EINTR)
+                    continue;
+                err_sys("no reply from the factory server");
+            }
+            switch (ntohl(msg.purpose)) {
+                case ORDR_CONFIRM:   numFac = ntohl(msg.numFac); break;
+                case PRODUCTION_MSG: parts += ntohl(msg.partsMade); break;
+                case COMPLETION_MSG: done++; break;
+                case PROTOCOL_ERR:   err_quit("factory server sent PROTOCOL_ERR\n");
+            }
+        }
+        if (parts != orderSize)
+            err_quit("factory server made the wrong number of parts\n");
+    }
+    double sec = (nowMs() - start) / 1000.0;
+    close(sd);
+
+    report("orders_per_sec", orders / sec, "orders/s", 1, 15);
+}
+
+/*--------------------------------------------------------------------
+   Compare with a baseline file.  A tolerance >= 0 overrides the
+   per-benchmark ones.
+----------------------------------------------------------------------*/
+static int compareBaseline(const char *path, double override) {
+    FILE *fp = fopen(path, "r");
+    char  line[128], name[40], unit[16], better[8], *flags = NULL;
+    double base;
+    int   regressions = 0;
+
+    if (fp == NULL)
+        err_sys("Failed to open the baseline file");
+
+    fprintf(stderr, "\n%-20s %12s %12s %9s %9s\n", "Benchmark", "Baseline", "Current", "Change", "Allowed");
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (strncmp(line, "# cflags", 8) == 0) {
+            line[strcspn(line, "\n")] = '\0';
+            flags = strdup(line[8] == ' ' ? line + 9 : line + 8);
+            if (strcmp(flags, BUILD_CFLAGS) != 0) {
+                fprintf(stderr, "Baseline was built with CFLAGS '%s', this benchmark with '%s': not comparable\n",
+                        flags, BUILD_CFLAGS);
+                exit(2);
+            }
+            continue;
+        }
+        if (flags == NULL) {
+            fprintf(stderr, "Baseline '%s' does not say which CFLAGS it was built with: not comparable\n", path);
+            exit(2);
+        }
+        if (sscanf(line, "%39s %lf %15s %7s", name, &base, unit, better) != 4)
+            continue;
+        for (int i = 0; i < numResults; i++) {
+            if (strcmp(results[i].name, name) != 0)
+                continue;
+            double tolerance = (override >= 0) ? override : results[i].tolerance;
+            double change = (base != 0) ? (results[i].value - base) / base * 100 : 0;
+            double worse = results[i].higherIsBetter ? -change : change;
+            int gated = (results[i].tolerance != NOT_GATED);
+            int regressed = gated && (worse > tolerance);
+            char allowed[16] = "-";
+            if (gated)
+                snprintf(allowed, sizeof(allowed), "%.0f%%", tolerance);
+            fprintf(stderr, "%-20s %12.3f %12.3f %+8.1f%% %9s  %s\n", name, base, results[i].value, change,
+                   allowed, regressed ? "REGRESSED" : (gated ? "ok" : "info"));
+            regressions += regressed;
+        }
+    }
+    fclose(fp);
+    free(flags);
+
+    fprintf(stderr, "============================================\n");
+    fprintf(stderr, "%d benchmark(s) regressed by more than their tolerance\n\n", regressions);
+    return regressions;
+}
+
+int main(int argc, char *argv[]) {
+    const char *baseline = NULL, *server = NULL;
+    double tolerance = -1;
+    int opt, orders = 200;
+
+    while ((opt = getopt(argc, argv, "c:t:e:n:")) != -1) {
+        switch (opt) {
+            case 'c': baseline = optarg; break;
+            case 't': tolerance = atof(optarg); break;
+            case 'e': server = optarg; break;
+            case 'n': orders = atoi(optarg); break;
+            default:
+                printf("BENCHMARK Usage: %s [-e [ip:]port [-n orders]] [-c baselineFile [-t tolerance%%]]\n", argv[0]);
+                exit(-1);
+        }
+    }
+
+    printf("# cflags %s\n", BUILD_CFLAGS);
+    benchEncodeDecode();
+    benchClaim("claim_mutex", claimMutexThread);
+    benchClaim("claim_atomic", claimAtomicThread);
+    benchLoopback();
+    benchBackend("send_sockets", NET_SOCKETS);
+    benchBackend("send_uring", NET_URING);
+    if (server != NULL)
+        benchOrders(server, orders, 500);
+
+    if (baseline != NULL && compareBaseline(baseline, tolerance) > 0)
+        return 1;
+    return 0;
+}
@@ -0,0 +1,82 @@
+//---------------------------------------------------------------------
+// Assignment : PA-04 Multi-Threaded UDP Server
+// Date       :
+// Author     : Joshua Cassada and Thomas Cantrell
+//
+// Message capture for the FACTORY server.  See capture.h
+//----------------------------------------------------------------------
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "wrappers.h"
+#include "capture.h"
+
+static FILE            *capFile = NULL;
+static double           capStart;
+static pthread_mutex_t  capMutex = PTHREAD_MUTEX_INITIALIZER;
+
+void captureOpen(const char *path, double speedup) {
+    if ((capFile = fopen(path, "w")) == NULL)
+        err_sys("Failed to open the capture file");
+    fprintf(capFile, "# factory capture: usec dir peer purpose orderSize numFac facID capacity partsMade duration\n");
+    fprintf(capFile, "# speedup %g\n", speedup);
+    capStart = nowMs();
+}
+
+void captureMsg(int out, const msgBuf *m, const struct sockaddr_in *peer) {
+    char ip[INET_ADDRSTRLEN];
+
+    if (capFile == NULL)
+        return;
+
+    inet_ntop(AF_INET, &peer->sin_addr, ip, sizeof(ip));
+    pthread_mutex_lock(&capMutex);
+    fprintf(capFile, "%lld %s %s:%d %d %u %u %u %u %u %u\n",
+            (long long)((nowMs() - capStart) * 1000), out ? "out" : "in", ip, ntohs(peer->sin_port),
+            (int) ntohl(m->purpose), ntohl(m->orderSize), ntohl(m->numFac), ntohl(m->facID),
+            ntohl(m->capacity), ntohl(m->partsMade), ntohl(m->duration));
+    pthread_mutex_unlock(&capMutex);
+}
+
+void captureClose(void) {
+    if (capFile != NULL)
+        fclose(capFile);
+    capFile = NULL;
+}
+
+int captureRead(FILE *fp, captureRec *rec, double *speedup) {
+    char     line[256], dir[8], ip[INET_ADDRSTRLEN];
+    int      port, purpose;
+    unsigned f[6];
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (line[0] == '#')
+            sscanf(line, "# speedup %lf", speedup);
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+        if (sscanf(line, "%lld %7s %15[^:]:%d %d %u %u %u %u %u %u", &rec->usec, dir, ip, &port,
+                   &purpose, &f[0], &f[1], &f[2], &f[3], &f[4], &f[5]) != 11)
+            continue;
+
+        rec->out = (strcmp(dir, "out") == 0);
+        memset(&rec->peer, 0, sizeof(rec->peer));
+        rec->peer.sin_family = AF_INET;
+        rec->peer.sin_port = htons(port);
+        inet_pton(AF_INET, ip, &rec->peer.sin_addr);
+
+        rec->msg.purpose   = htonl(purpose);
+        rec->msg.orderSize = htonl(f[0]);
+        rec->msg.numFac    = htonl(f[1]);
+        rec->msg.facID     = htonl(f[2]);
+        rec->msg.capacity  = htonl(f[3]);
+        rec->msg.partsMade = htonl(f[4]);
+        rec->msg.duration  = htonl(f[5]);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,38 @@
+//---------------------------------------------------------------------
+// Assignment : PA-04 Multi-Threaded UDP Server
+// Date       :
+// Author     : Joshua Cassada and Thomas Cantrell
+//
+// Message capture for the FACTORY server, and the trace format shared
+// with the replay tool.  Every message the server receives or sends is
+// written as one text line:
+//
+//   <usec> <in|out> <ip>:<port> <purpose> <orderSize> <numFac> <facID>
+//          <capacity> <partsMade> <duration>
+//
+// where <usec> counts from the moment the capture was opened and all
+// message fields are in host byte order.  A "# speedup <x>" header line
+// records the server's -x, so replays can scale the recorded times.
+//----------------------------------------------------------------------
+
+#ifndef  CAPTURE_H
+#define  CAPTURE_H
+
+#include <stdio.h>
+#include <netinet/in.h>
+#include "message.h"
+
+typedef struct {
+    long long          usec ;
+    int                out ;      /* 1 if the server sent it */
+    struct sockaddr_in peer ;
+    msgBuf             msg ;      /* network byte order, as on the wire */
+} captureRec ;
+
+void  captureOpen( const char *path , double speedup ) ;
+void  captureMsg( int out , const msgBuf *m , const struct sockaddr_in *peer ) ;
+void  captureClose( void ) ;
+
+int   captureRead( FILE *fp , captureRec *rec , double *speedup ) ;   /* 1 = got one, 0 = end of trace */
+
+#endif
@@ -0,0 +1,432 @@
+//---------------------------------------------------------------------
+// Assignment : PA-04 Multi-Threaded UDP Server
+// Date       :
+// Author     : Joshua Cassada and Thomas Cantrell
+//
+// Coordinator ( cluster ) mode of the FACTORY server.  See cluster.h
+//
+// Every part of an order sent to a backend is a "job" with its own
+// socket, so replies are told apart by the socket they arrive on.  The
+// client is shown a single set of sub-factory IDs ("slots"); each
+// backend sub-factory reports under one slot, and a slot's COMPLETION is
+// only relayed once every backend sub-factory mapped onto it finished.
+// When a backend dies (PROTOCOL_ERR, ICMP error, or silence) the parts
+// it had not reported yet go to a new job on a live backend, and that
+// job keeps reporting under the failed job's slots.
+//----------------------------------------------------------------------
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <poll.h>
+
+#include "wrappers.h"
+#include "netio.h"
+#include "cluster.h"
+
+#define CLUSTER_MAXJOBS    64
+#define CONFIRM_MS       2000   /* how long a backend may take to confirm   */
+#define SILENCE_MS       5000   /* longest gap between a backend's messages */
+#define TICK_MS           200
+
+typedef struct sockaddr SA;
+
+typedef struct {
+    struct sockaddr_in addr;
+    int                alive;
+} clusterNode;
+
+typedef enum { JOB_SENT , JOB_RUNNING , JOB_DONE , JOB_FAILED } jobState_t;
+
+typedef struct {
+    int        node, sd;
+    jobState_t state;
+    unsigned   parts, made;       /* parts asked for / reported made so far */
+    unsigned   numFac, completed; /* backend sub-factories / how many completed */
+    unsigned   offset, span;      /* client slots this job reports under */
+    double     lastHeard;
+    unsigned char facDone[MAXFACTORIES + 1];
+} clusterJob;
+
+static clusterNode nodes[CLUSTER_MAXNODES];
+static int         numNodes = 0, nextNode = 0;
+
+// State of the order being coordinated
+static clusterJob  jobs[CLUSTER_MAXJOBS];
+static int         numJobs, confirmed, aborted;
+static unsigned    numSlots, pending[MAXFACTORIES + 1], slotMade[MAXFACTORIES + 1];
+static const struct sockaddr_in *client;
+
+static void sendToClient(int purpose, unsigned facID, unsigned partsMade) {
+    msgBuf msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.purpose = htonl(purpose);
+    msg.facID = htonl(facID);
+    msg.partsMade = htonl(partsMade);
+    netSend(&msg, client);
+}
+
+/*--------------------------------------------------------------------
+   Backend list
+----------------------------------------------------------------------*/
+int clusterInit(const char *spec) {
+    char *copy = strdup(spec), *save = NULL, *item;
+
+    numNodes = 0;
+    for (item = strtok_r(copy, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save)) {
+        if (numNodes == CLUSTER_MAXNODES) {
+            free(copy);
+            return -1;
+        }
+        clusterNode *n = &nodes[numNodes];
+        char *colon = strrchr(item, ':');
+        const char *ip = "127.0.0.1";
+
+        if (colon != NULL) {
+            *colon = '\0';
+            ip = item;
+            item = colon + 1;
+        }
+        memset(&n->addr, 0, sizeof(n->addr));
+        n->addr.sin_family = AF_INET;
+        n->addr.sin_port = htons(atoi(item));
+        if (n->addr.sin_port == 0 || inet_pton(AF_INET, ip, &n->addr.sin_addr) <= 0) {
+            free(copy);
+            return -1;
+        }
+        n->alive = 1;
+        numNodes++;
+    }
+    free(copy);
+    return (numNodes > 0) ? numNodes : -1;
+}
+
+// Round-robin over the backends that are still alive
+static int pickNode(void) {
+    for (int i = 0; i < numNodes; i++) {
+        int n = (nextNode + i) % numNodes;
+        if (nodes[n].alive) {
+            nextNode = n + 1;
+            return n;
+        }
+    }
+    return -1;
+}
+
+static void nodeName(int node, char *buf, size_t len) {
+    char ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &nodes[node].addr.sin_addr, ip, sizeof(ip));
+    snprintf(buf, len, "%s:%d", ip, ntohs(nodes[node].addr.sin_port));
+}
+
+/*--------------------------------------------------------------------
+   Jobs
+----------------------------------------------------------------------*/
+static int startJob(unsigned parts, int node) {
+    if (numJobs == CLUSTER_MAXJOBS)
+        err_quit("Coordinator: too many backend jobs for one order\n");
+
+    clusterJob *J = &jobs[numJobs];
+    memset(J, 0, sizeof(*J));
+    J->node = node;
+    J->parts = parts;
+    J->state = JOB_SENT;
+    J->lastHeard = nowMs();
+
+    // Connected, so an unreachable backend shows up as ECONNREFUSED
+    if ((J->sd = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+        err_sys("Coordinator: socket failed");
+    if (connect(J->sd, (SA*)&nodes[node].addr, sizeof(nodes[node].addr)) < 0)
+        err_sys("Coordinator: connect failed");
+
+    msgBuf msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.purpose = htonl(REQUEST_MSG);
+    msg.orderSize = htonl(parts);
+    send(J->sd, &msg, sizeof(msg), 0);
+
+    char name[40];
+    nodeName(node, name, sizeof(name));
+    printf("Coordinator: sent { REQUEST , OrderSize=%d } to backend %s\n", parts, name);
+    return numJobs++;
+}
+
+static int jobActive(const clusterJob *J) {
+    return J->state == JOB_SENT || J->state == JOB_RUNNING;
+}
+
+// A backend serves one order at a time, so only its oldest active job
+// is expected to be talking.
+static int jobIsHead(int j) {
+    for (int k = 0; k < j; k++)
+        if (jobs[k].node == jobs[j].node && jobActive(&jobs[k]))
+            return 0;
+    return 1;
+}
+
+static void jobClose(int j, jobState_t state) {
+    jobs[j].state = state;
+    close(jobs[j].sd);
+    for (int k = j + 1; k < numJobs; k++)
+        if (jobs[k].node == jobs[j].node && jobActive(&jobs[k])) {
+            jobs[k].lastHeard = nowMs();
+            break;
+        }
+}
+
+static unsigned slotOf(const clusterJob *J, unsigned k) {
+    return (J->offset + k % J->span) % numSlots + 1;
+}
+
+static void slotRelease(unsigned slot) {
+    if (--pending[slot] == 0)
+        sendToClient(COMPLETION_MSG, slot, slotMade[slot]);
+}
+
+static void jobFailed(int j) {
+    clusterJob *J = &jobs[j];
+    unsigned remaining = (J->made < J->parts) ? J->parts - J->made : 0;
+    jobState_t was = J->state;
+
+    jobClose(j, JOB_FAILED);
+
+    if (!confirmed) {
+        // The client has not seen any sub-factory yet: just redo it
+        int n = pickNode();
+        if (n < 0)
+            aborted = 1;
+        else
+            startJob(J->parts, n);
+        return;
+    }
+
+    if (remaining > 0) {
+        int n = pickNode();
+        if (n < 0) {
+            aborted = 1;
+            return;
+        }
+        int r = startJob(remaining, n);
+        jobs[r].offset = J->offset;
+        jobs[r].span = J->span;
+        // Hold the slots until the new job says how many sub-factories it has
+        for (unsigned k = 0; k < J->span; k++)
+            pending[slotOf(&jobs[r], k)]++;
+    }
+
+    if (was == JOB_RUNNING) {
+        for (unsigned f = 1; f <= J->numFac; f++)
+            if (!J->facDone[f])
+                slotRelease(slotOf(J, f - 1));
+    }
+    else {
+        for (unsigned k = 0; k < J->span; k++)
+            slotRelease(slotOf(J, k));
+    }
+}
+
+static void nodeFailed(int node) {
+    char name[40];
+    nodeName(node, name, sizeof(name));
+    printf("Coordinator: backend %s FAILED, rebalancing its remaining parts\n", name);
+
+    nodes[node].alive = 0;
+    for (int j = 0; j < numJobs; j++)
+        if (jobs[j].node == node && jobActive(&jobs[j]))
+            jobFailed(j);
+}
+
+/*--------------------------------------------------------------------
+   Handle one message a backend sent for job j
+----------------------------------------------------------------------*/
+static void jobMessage(int j, msgBuf *msg) {
+    clusterJob *J = &jobs[j];
+    unsigned fac = ntohl(msg->facID);
+
+    J->lastHeard = nowMs();
+    switch (ntohl(msg->purpose)) {
+        case ORDR_CONFIRM:
+            if (J->state != JOB_SENT)
+                break;
+            J->state = JOB_RUNNING;
+            J->numFac = ntohl(msg->numFac);
+            if (J->numFac > MAXFACTORIES)
+                J->numFac = MAXFACTORIES;
+            if (confirmed) {
+                for (unsigned f = 1; f <= J->numFac; f++)
+                    pending[slotOf(J, f - 1)]++;
+                for (unsigned k = 0; k < J->span; k++)
+                    slotRelease(slotOf(J, k));
+            }
+            break;
+
+        case PRODUCTION_MSG:
+            if (J->state != JOB_RUNNING || fac < 1 || fac > J->numFac)
+                break;
+            J->made += ntohl(msg->partsMade);
+            slotMade[slotOf(J, fac - 1)] += ntohl(msg->partsMade);
+            msg->facID = htonl(slotOf(J, fac - 1));
+            netSend(msg, client);
+            break;
+
+        case COMPLETION_MSG:
+            if (J->state != JOB_RUNNING || fac < 1 || fac > J->numFac || J->facDone[fac])
+                break;
+            J->facDone[fac] = 1;
+            if (++J->completed == J->numFac)
+                jobClose(j, JOB_DONE);
+            slotRelease(slotOf(J, fac - 1));
+            break;
+
+        case PROTOCOL_ERR:
+            nodeFailed(J->node);
+            break;
+    }
+}
+
+// Before the client is confirmed only the unconfirmed jobs are read;
+// the others keep their production messages queued in their sockets.
+static int jobPolled(int j) {
+    return jobActive(&jobs[j]) && (confirmed || jobs[j].state == JOB_SENT);
+}
+
+// Wait up to one tick for backend messages.  Only the jobs being read
+// can be timed out for silence.
+static void pollJobs(void) {
+    struct pollfd pfd[CLUSTER_MAXJOBS];
+    int           idx[CLUSTER_MAXJOBS], n = 0;
+
+    for (int j = 0; j < numJobs; j++)
+        if (jobPolled(j)) {
+            pfd[n].fd = jobs[j].sd;
+            pfd[n].events = POLLIN;
+            idx[n++] = j;
+        }
+
+    if (poll(pfd, n, TICK_MS) < 0 && errno != EINTR)
+        err_sys("Coordinator: poll failed");
+
+    for (int i = 0; i < n; i++) {
+        int j = idx[i];
+        if (!jobActive(&jobs[j]) || !(pfd[i].revents & (POLLIN | POLLERR)))
+            continue;
+
+        msgBuf msg;
+        memset(&msg, 0, sizeof(msg));
+        if (recv(jobs[j].sd, &msg, sizeof(msg), 0) < 0) {
+            if (errno != EINTR)
+                nodeFailed(jobs[j].node);
+            continue;
+        }
+        jobMessage(j, &msg);
+    }
+
+    double now = nowMs();
+    for (int j = 0; j < numJobs; j++)
+        if (jobPolled(j) && jobIsHead(j) &&
+            now - jobs[j].lastHeard > (jobs[j].state == JOB_SENT ? CONFIRM_MS : SILENCE_MS))
+            nodeFailed(jobs[j].node);
+}
+
+static int slotsPending(void) {
+    for (unsigned s = 1; s <= numSlots; s++)
+        if (pending[s] > 0)
+            return 1;
+    return 0;
+}
+
+static int unconfirmedJobs(void) {
+    for (int j = 0; j < numJobs; j++)
+        if (jobs[j].state == JOB_SENT)
+            return 1;
+    return 0;
+}
+
+/*--------------------------------------------------------------------
+   Coordinate one order from the client across the backends
+----------------------------------------------------------------------*/
+void clusterOrder(const msgBuf *req, const struct sockaddr_in *clnt, const char *myName) {
+    unsigned orderSize = ntohl(req->orderSize), alive = 0, total = 0;
+
+    client = clnt;
+    numJobs = confirmed = aborted = 0;
+    numSlots = 0;
+    memset(pending, 0, sizeof(pending));
+    memset(slotMade, 0, sizeof(slotMade));
+
+    // A backend that failed an earlier order may be back by now, so
+    // every order starts out trying all of them again
+    for (int i = 0; i < numNodes; i++)
+        alive += nodes[i].alive = 1;
+    if (alive == 0 || orderSize == 0) {
+        printf("Coordinator: no live backends for this order\n");
+        sendToClient(PROTOCOL_ERR, 0, 0);
+        netFlush();
+        return;
+    }
+
+    // Split the order evenly, never giving a backend zero parts
+    unsigned shares = (orderSize < alive) ? orderSize : alive;
+    for (unsigned i = 0; i < shares; i++)
+        startJob(orderSize / shares + (i < orderSize % shares), pickNode());
+
+    while (unconfirmedJobs() && !aborted)
+        pollJobs();
+
+    if (!aborted) {
+        for (int j = 0; j < numJobs; j++)
+            if (jobs[j].state == JOB_RUNNING) {
+                jobs[j].offset = total;
+                jobs[j].span = jobs[j].numFac;
+                total += jobs[j].numFac;
+            }
+        numSlots = (total < MAXFACTORIES) ? total : MAXFACTORIES;
+        for (int j = 0; j < numJobs; j++)
+            if (jobs[j].state == JOB_RUNNING)
+                for (unsigned f = 1; f <= jobs[j].numFac; f++)
+                    pending[slotOf(&jobs[j], f - 1)]++;
+
+        msgBuf msg = *req;
+        msg.purpose = htonl(ORDR_CONFIRM);
+        msg.numFac = htonl(numSlots);
+        netSend(&msg, client);
+        confirmed = 1;
+
+        // The running jobs were not read while waiting for the others to
+        // confirm, so their silence is timed from here
+        for (int j = 0; j < numJobs; j++)
+            jobs[j].lastHeard = nowMs();
+        printf("\nFACTORY ( by %s ) sent this Order Confirmation to the client { ORDR_CNFRM , numFacThrds=%d }\n\n",
+               myName, numSlots);
+
+        while (slotsPending() && !aborted)
+            pollJobs();
+    }
+
+    if (aborted) {
+        printf("Coordinator: every backend failed, aborting the order\n");
+        sendToClient(PROTOCOL_ERR, 0, 0);
+        for (int j = 0; j < numJobs; j++)
+            if (jobActive(&jobs[j]))
+                jobClose(j, JOB_FAILED);
+    }
+    netFlush();
+
+    printf("\n****** FACTORY Coordinator ( by %s ) Summary Report *******\n", myName);
+    printf("Backend                Parts Asked   Parts Made   Status\n");
+    unsigned grandTotal = 0;
+    for (int j = 0; j < numJobs; j++) {
+        char name[40];
+        nodeName(jobs[j].node, name, sizeof(name));
+        printf("%-22s   %5d        %5d      %s\n", name, jobs[j].parts, jobs[j].made,
+               jobs[j].state == JOB_DONE ? "done" : "failed");
+        grandTotal += jobs[j].made;
+    }
+    printf("============================================\n");
+    printf("Grand total parts made  =  %d  vs  order size of   %d\n\n", grandTotal, orderSize);
+}
@@ -0,0 +1,23 @@
+//---------------------------------------------------------------------
+// Assignment : PA-04 Multi-Threaded UDP Server
+// Date       :
+// Author     : Joshua Cassada and Thomas Cantrell
+//
+// Coordinator ( cluster ) mode of the FACTORY server.
+// The front factory splits each order across several backend factory
+// servers, merges their replies into one order for the client, and
+// hands the unfinished parts of a failed backend to the others.
+//----------------------------------------------------------------------
+
+#ifndef  CLUSTER_H
+#define  CLUSTER_H
+
+#include <netinet/in.h>
+#include "message.h"
+
+#define CLUSTER_MAXNODES   16
+
+int   clusterInit( const char *spec ) ;   /* "[ip:]port,[ip:]port,..." -> #backends, or -1 */
+void  clusterOrder( const msgBuf *req , const struct sockaddr_in *client , const char *myName ) ;
+
+#endif
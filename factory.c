@@ -12,6 +12,10 @@
 #include <pthread.h>
 #include "wrappers.h"
 #include "message.h"
+#include "netio.h"
+#include "cluster.h"
+#include "capture.h"
+#include "trace.h"
 
 #define IPSTRLEN 50
 #define MAXFACTORIES 20
@@ -22,6 +26,7 @@ typedef struct {
     int facID;
     int capacity;
     int duration;
+    long long createdAt;   /* trace clock, when main created the thread */
 } FactoryData;
 
 // Global variables
@@ -32,21 +37,128 @@ pthread_mutex_t orderMutex = PTHREAD_MUTEX_INITIALIZER;
 int sd;
 struct sockaddr_in srvrSkt, clntSkt;
 char *myName;
+unsigned orderID;          /* the client's port; correlates trace spans */
+
+// Sub-factory profiles come from a profile file when one is given,
+// otherwise from rand() ( seeded with -s for reproducible runs ).
+// Production sleeps are divided by 'speedup'; the reported durations are not.
+int profileCap[MAXFACTORIES], profileDur[MAXFACTORIES], numProfiles = 0;
+double speedup = 1.0;
+
+void loadProfiles(const char *path) {
+    FILE *fp = fopen(path, "r");
+    char line[128];
+
+    if (fp == NULL)
+        err_sys("Failed to open the profile file");
+
+    while (numProfiles < MAXFACTORIES && fgets(line, sizeof(line), fp) != NULL) {
+        if (line[0] == '#')
+            continue;
+        if (sscanf(line, "%d %d", &profileCap[numProfiles], &profileDur[numProfiles]) == 2 &&
+            profileCap[numProfiles] > 0 && profileDur[numProfiles] >= 0)
+            numProfiles++;
+    }
+    fclose(fp);
+
+    if (numProfiles == 0)
+        err_quit("The profile file has no 'capacity duration' lines\n");
+}
+
+void pickProfile(int i, FactoryData *data) {
+    if (numProfiles > 0) {
+        data->capacity = profileCap[i % numProfiles];
+        data->duration = profileDur[i % numProfiles];
+    }
+    else {
+        data->capacity = 10 + (rand() % 41);
+        data->duration = 500 + (rand() % 701);
+    }
+}
+
+// Adaptive pacing ( -a ).  Each sub-factory's real rate is tracked as a
+// moving average of capacity / measured iteration time ( an iteration
+// takes its full duration however few parts it makes ).  Before every
+// batch the remaining parts are scheduled over the sub-factories
+// earliest-finish-first, and a sub-factory only takes what that schedule
+// gives it now; if it gets nothing it retires so the others finish sooner.
+// Everything here is guarded by orderMutex.
+#define RATE_WEIGHT  0.5     /* weight of the newest measurement */
+#define MIN_ITER_MS  0.01
+
+int adaptive = 0, numSubFactories = 0;
+int facCapacity[MAXFACTORIES], retired[MAXFACTORIES];
+double estRate[MAXFACTORIES], freeAt[MAXFACTORIES];
+
+void paceInit(int f, FactoryData *data) {
+    double ms = data->duration / speedup;
+
+    facCapacity[f] = data->capacity;
+    estRate[f] = data->capacity / (ms > MIN_ITER_MS ? ms : MIN_ITER_MS);
+    freeAt[f] = nowMs();
+    retired[f] = 0;
+}
+
+void paceUpdate(int f, double iterMs) {
+    double rate = facCapacity[f] / (iterMs > MIN_ITER_MS ? iterMs : MIN_ITER_MS);
+    estRate[f] = (1 - RATE_WEIGHT) * estRate[f] + RATE_WEIGHT * rate;
+}
+
+int paceBatch(int f, int remaining) {
+    double t[MAXFACTORIES], now = nowMs();
+
+    for (int g = 0; g < numSubFactories; g++)
+        t[g] = (g == f || freeAt[g] < now) ? now : freeAt[g];
+
+    while (remaining > 0) {
+        int best = -1;
+        double bestEnd = 0;
+        for (int g = 0; g < numSubFactories; g++) {
+            double end = t[g] + facCapacity[g] / estRate[g];
+            if (!retired[g] && (best < 0 || end < bestEnd)) {
+                best = g;
+                bestEnd = end;
+            }
+        }
+
+        int batch = (remaining < facCapacity[best]) ? remaining : facCapacity[best];
+        if (best == f) {
+            freeAt[f] = bestEnd;
+            return batch;
+        }
+        remaining -= batch;
+        t[best] = bestEnd;
+    }
+
+    retired[f] = 1;
+    return 0;
+}
 
 void* subFactory(void* arg) {
     FactoryData* data = (FactoryData*)arg;
     int partsImade = 0, myIterations = 0;
-    
+    long long t0;
+    double iterStart = 0;
+
+    traceSpan("thread_start", orderID, data->createdAt, traceNow());
     printf("Created Factory Thread # %d with capacity = %2d parts & duration = %4d mSec\n",
            data->facID, data->capacity, data->duration);
     
     while (1) {
+        t0 = traceNow();
         pthread_mutex_lock(&orderMutex);
-        if (activeThreads <= 0) {
+        traceSpan("lock_wait", orderID, t0, traceNow());
+        int toMake = (activeThreads < data->capacity) ? activeThreads : data->capacity;
+        if (adaptive && toMake > 0) {
+            if (myIterations > 0)
+                paceUpdate(data->facID - 1, nowMs() - iterStart);
+            toMake = paceBatch(data->facID - 1, activeThreads);
+            iterStart = nowMs();
+        }
+        if (toMake <= 0) {
             pthread_mutex_unlock(&orderMutex);
             break;
         }
-        int toMake = (activeThreads < data->capacity) ? activeThreads : data->capacity;
         activeThreads -= toMake;
         pthread_mutex_unlock(&orderMutex);
 
@@ -57,22 +169,26 @@ void* subFactory(void* arg) {
                myName, data->facID, toMake, data->duration);
 
         msgBuf msg;
+        memset(&msg, 0, sizeof(msg));
         msg.purpose = htonl(PRODUCTION_MSG);
         msg.facID = htonl(data->facID);
         msg.capacity = htonl(data->capacity);
         msg.partsMade = htonl(toMake);
         msg.duration = htonl(data->duration);
 
-        sendto(sd, &msg, sizeof(msg), 0, (SA*)&clntSkt, sizeof(clntSkt));
-        usleep(data->duration * 1000);
+        netSend(&msg, &clntSkt);
+        t0 = traceNow();
+        usleep((useconds_t)(data->duration * 1000 / speedup));
+        traceSpan("produce", orderID, t0, traceNow());
     }
 
     msgBuf msg;
+    memset(&msg, 0, sizeof(msg));
     msg.purpose = htonl(COMPLETION_MSG);
     msg.facID = htonl(data->facID);
     msg.partsMade = htonl(partsImade);
 
-    sendto(sd, &msg, sizeof(msg), 0, (SA*)&clntSkt, sizeof(clntSkt));
+    netSend(&msg, &clntSkt);
 
     printf(">>> Factory # %d : Terminating after making total of %d parts in %d iterations\n",
            data->facID, partsImade, myIterations);
@@ -80,6 +196,7 @@ void* subFactory(void* arg) {
     totalPartsPerFactory[data->facID - 1] = partsImade;
     iterationsPerFactory[data->facID - 1] = myIterations;
     
+    traceThreadDone();
     free(data);
     pthread_exit(NULL);
 }
@@ -93,25 +210,84 @@ void goodbye(int sig) {
     exit(0);
 }
 
+void usage(const char *prog) {
+    printf("Usage: %s [-a] [-b sockets|uring] [-c [ip:]port,...] [-s seed] [-p profileFile]\n"
+           "       [-x speedup] [-w captureFile] [-T traceFile] [numThreads] [port]\n"
+           "       ( with -c there are no sub-factories, so the only argument is [port] )\n", prog);
+    exit(1);
+}
+
 int main(int argc, char *argv[]) {
     myName = "Joshua Cassada and Thomas Cantrell";
     unsigned short port = 5000;
-    int N = 1;
-    
-    printf("\nThis is the FACTORY server ( by %s )\n\n", myName);
-    printf("I will attempt to accept orders at port %d and use %d sub-factories.\n\n", port, N);
-
-    switch (argc) {
-        case 1: break;
-        case 2: N = atoi(argv[1]); break;
-        case 3: 
-            N = atoi(argv[1]);
-            port = atoi(argv[2]);
+    int N = 1, opt;
+    netBackend_t backend = NET_SOCKETS;
+    int clusterMode = 0;
+    char *capturePath = NULL;
+
+    while ((opt = getopt(argc, argv, "ab:c:s:p:x:w:T:")) != -1) {
+        switch (opt) {
+            case 'a':
+                adaptive = 1;
+                break;
+            case 'b':
+                if (netParseBackend(optarg, &backend) < 0)
+                    usage(argv[0]);
+                break;
+            case 'c':
+                if ((clusterMode = clusterInit(optarg)) < 0)
+                    usage(argv[0]);
+                break;
+            case 's':
+                srand(strtoul(optarg, NULL, 10));
+                break;
+            case 'p':
+                loadProfiles(optarg);
+                break;
+            case 'x':
+                if ((speedup = atof(optarg)) <= 0)
+                    usage(argv[0]);
+                break;
+            case 'w':
+                capturePath = optarg;
+                break;
+            case 'T':
+                traceOpen(optarg, "factory");
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if (capturePath != NULL)
+        captureOpen(capturePath, speedup);
+
+    // A coordinator runs no sub-factories of its own, so it takes the
+    // port alone rather than quietly ignoring a thread count
+    if (clusterMode && argc - optind > 1)
+        usage(argv[0]);
+
+    switch (argc - optind) {
+        case 0: break;
+        case 1:
+            if (clusterMode)
+                port = atoi(argv[optind]);
+            else
+                N = atoi(argv[optind]);
+            break;
+        case 2: 
+            N = atoi(argv[optind]);
+            port = atoi(argv[optind + 1]);
             break;
         default:
-            printf("Usage: %s [numThreads] [port]\n", argv[0]);
-            exit(1);
+            usage(argv[0]);
     }
+    
+    printf("\nThis is the FACTORY server ( by %s )\n\n", myName);
+    if (clusterMode)
+        printf("I will attempt to accept orders at port %d and split them across %d backend factories.\n\n", port, clusterMode);
+    else
+        printf("I will attempt to accept orders at port %d and use %d sub-factories.\n\n", port, N);
 
     sd = socket(AF_INET, SOCK_DGRAM, 0);
     memset(&srvrSkt, 0, sizeof(srvrSkt));
@@ -123,6 +299,10 @@ int main(int argc, char *argv[]) {
         err_sys("bind failed");
     
     printf("Bound socket %d to IP 0.0.0.0 Port %d\n\n", sd, port);
+    traceSocket(sd);
+
+    backend = netInit(sd, backend);
+    printf("Sending through the %s backend\n\n", netBackendName(backend));
     
     sigactionWrapper(SIGINT, goodbye);
     sigactionWrapper(SIGTERM, goodbye);
@@ -133,6 +313,10 @@ int main(int argc, char *argv[]) {
         msgBuf msg;
         socklen_t client_len = sizeof(clntSkt);
         recvfrom(sd, &msg, sizeof(msg), 0, (SA*)&clntSkt, &client_len);
+        long long received = traceNow();
+        captureMsg(0, &msg, &clntSkt);
+        orderID = ntohs(clntSkt.sin_port);
+        traceSpan("queue", orderID, traceArrival(sd), received);
         
         char ipStr[IPSTRLEN];
         inet_ntop(AF_INET, &clntSkt.sin_addr, ipStr, IPSTRLEN);
@@ -140,6 +324,11 @@ int main(int argc, char *argv[]) {
                myName, ntohl(msg.orderSize));
         printf("        From IP %s Port %d\n", ipStr, ntohs(clntSkt.sin_port));
 
+        if (clusterMode) {
+            clusterOrder(&msg, &clntSkt, myName);
+            continue;
+        }
+
         activeThreads = ntohl(msg.orderSize);
         
         struct timeval startTime;
@@ -147,17 +336,24 @@ int main(int argc, char *argv[]) {
         
         msg.purpose = htonl(ORDR_CONFIRM);
         msg.numFac = htonl(N);
-        sendto(sd, &msg, sizeof(msg), 0, (SA*)&clntSkt, client_len);
+        netSend(&msg, &clntSkt);
         
         printf("\nFACTORY ( by %s ) sent this Order Confirmation to the client { ORDR_CNFRM , numFacThrds=%d }\n\n",
                myName, N);
 
         pthread_t threads[MAXFACTORIES];
+        FactoryData* profiles[MAXFACTORIES];
+        numSubFactories = N;
+        // Every profile is known to the pacer before any sub-factory claims parts
+        for (int i = 0; i < N; i++) {
+            profiles[i] = malloc(sizeof(FactoryData));
+            profiles[i]->facID = i + 1;
+            pickProfile(i, profiles[i]);
+            paceInit(i, profiles[i]);
+        }
         for (int i = 0; i < N; i++) {
-            FactoryData* data = malloc(sizeof(FactoryData));
-            data->facID = i + 1;
-            data->capacity = 10 + (rand() % 41);
-            data->duration = 500 + (rand() % 701);
+            FactoryData* data = profiles[i];
+            data->createdAt = traceNow();
             
             Pthread_create(&threads[i], NULL, subFactory, data);
         }
@@ -165,6 +361,9 @@ int main(int argc, char *argv[]) {
         for (int i = 0; i < N; i++) {
             Pthread_join(threads[i], NULL);
         }
+        netFlush();
+        traceSpan("order", orderID, received, traceNow());
+        traceThreadDone();
         
         struct timeval endTime;
         gettimeofday(&endTime, NULL);
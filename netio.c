@@ -0,0 +1,343 @@
+//---------------------------------------------------------------------
+// Assignment : PA-04 Multi-Threaded UDP Server
+// Date       :
+// Author     : Joshua Cassada and Thomas Cantrell
+//
+// Outbound message path for the FACTORY server.  See netio.h
+//
+// The io_uring backend talks to the kernel through the raw system calls
+// so that no extra library is needed to build the server.  If the ring
+// cannot be created, or the kernel does not support IORING_OP_SENDMSG,
+// netInit() falls back to the plain sockets path.
+//----------------------------------------------------------------------
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <netinet/in.h>
+#include <linux/io_uring.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "wrappers.h"
+#include "netio.h"
+#include "capture.h"
+
+#define NETQ_SLOTS     1024   /* messages waiting for the sender thread */
+#define URING_DEPTH      64   /* most messages submitted in one batch   */
+
+typedef struct sockaddr SA;
+
+typedef struct {
+    msgBuf             msg;
+    struct sockaddr_in to;
+} netItem;
+
+static netBackend_t backend = NET_SOCKETS;
+static int          sock = -1;
+
+// Hand-off queue between the sub-factories and the sender thread
+static netItem         queue[NETQ_SLOTS];
+static unsigned        qHead = 0, qCount = 0;
+static unsigned long   queued = 0, sent = 0;
+static int             stopping = 0;
+static pthread_mutex_t qMutex    = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  qNotEmpty = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t  qNotFull  = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t  qDrained  = PTHREAD_COND_INITIALIZER;
+static pthread_t       senderTid;
+
+// The submission / completion rings shared with the kernel
+static int                  ringFd = -1, fixedFile = 0;
+static unsigned             sqEntries;
+static unsigned            *sqTail, *sqMask, *sqArray;
+static unsigned            *cqHead, *cqTail, *cqMask;
+static struct io_uring_sqe *sqes;
+static struct io_uring_cqe *cqes;
+static void                *sqPtr = MAP_FAILED, *cqPtr = MAP_FAILED, *sqePtr = MAP_FAILED;
+static size_t               sqLen, cqLen, sqeLen;
+
+/*--------------------------------------------------------------------
+   Thin wrappers for the io_uring system calls
+----------------------------------------------------------------------*/
+static int uringSetup(unsigned entries, struct io_uring_params *p) {
+    return (int) syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int uringEnter(unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    return (int) syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, flags, NULL, 0);
+}
+
+static int uringRegister(unsigned opcode, void *arg, unsigned nrArgs) {
+    return (int) syscall(__NR_io_uring_register, ringFd, opcode, arg, nrArgs);
+}
+
+static void uringClose(void) {
+    if (sqePtr != MAP_FAILED) munmap(sqePtr, sqeLen);
+    if (cqPtr != MAP_FAILED && cqPtr != sqPtr) munmap(cqPtr, cqLen);
+    if (sqPtr != MAP_FAILED) munmap(sqPtr, sqLen);
+    sqPtr = cqPtr = sqePtr = MAP_FAILED;
+    if (ringFd >= 0) close(ringFd);
+    ringFd = -1;
+}
+
+// Does the running kernel know how to do IORING_OP_SENDMSG ?
+static int uringCanSendmsg(void) {
+    size_t sz = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, sz);
+    int ok = 0;
+
+    if (probe == NULL)
+        return 0;
+    if (uringRegister(IORING_REGISTER_PROBE, probe, 256) == 0 &&
+        probe->last_op >= IORING_OP_SENDMSG &&
+        (probe->ops[IORING_OP_SENDMSG].flags & IO_URING_OP_SUPPORTED))
+        ok = 1;
+
+    free(probe);
+    return ok;
+}
+
+// 0 on success, otherwise the errno of the step that failed
+static int uringOpen(void) {
+    struct io_uring_params p;
+    int err;
+
+    memset(&p, 0, sizeof(p));
+    if ((ringFd = uringSetup(URING_DEPTH, &p)) < 0)
+        return errno;
+
+    sqLen  = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cqLen  = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    sqeLen = p.sq_entries * sizeof(struct io_uring_sqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (cqLen > sqLen)
+            sqLen = cqLen;
+        cqLen = sqLen;
+    }
+
+    sqPtr = mmap(NULL, sqLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                 ringFd, IORING_OFF_SQ_RING);
+    if (sqPtr == MAP_FAILED) {
+        err = errno;
+        goto fail;
+    }
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+        cqPtr = sqPtr;
+    else if ((cqPtr = mmap(NULL, cqLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                           ringFd, IORING_OFF_CQ_RING)) == MAP_FAILED) {
+        err = errno;
+        goto fail;
+    }
+
+    sqePtr = mmap(NULL, sqeLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                  ringFd, IORING_OFF_SQES);
+    if (sqePtr == MAP_FAILED) {
+        err = errno;
+        goto fail;
+    }
+
+    sqEntries = p.sq_entries;
+    sqTail  = (unsigned *)((char *)sqPtr + p.sq_off.tail);
+    sqMask  = (unsigned *)((char *)sqPtr + p.sq_off.ring_mask);
+    sqArray = (unsigned *)((char *)sqPtr + p.sq_off.array);
+    cqHead  = (unsigned *)((char *)cqPtr + p.cq_off.head);
+    cqTail  = (unsigned *)((char *)cqPtr + p.cq_off.tail);
+    cqMask  = (unsigned *)((char *)cqPtr + p.cq_off.ring_mask);
+    cqes    = (struct io_uring_cqe *)((char *)cqPtr + p.cq_off.cqes);
+    sqes    = (struct io_uring_sqe *) sqePtr;
+
+    if (!uringCanSendmsg()) {
+        err = EOPNOTSUPP;   /* no IORING_OP_SENDMSG in this kernel */
+        goto fail;
+    }
+
+    // Register the socket so the kernel skips the fd lookup on every send
+    fixedFile = (uringRegister(IORING_REGISTER_FILES, &sock, 1) == 0);
+    return 0;
+
+fail:
+    uringClose();
+    return err;
+}
+
+/*--------------------------------------------------------------------
+   Submit one batch of messages and wait for all of them to complete.
+   The SQEs are linked so the datagrams leave in the order they were
+   handed to netSend().  Anything the ring failed to send (and the rest
+   of the chain, which the kernel then cancels) is resent with sendto().
+----------------------------------------------------------------------*/
+static void uringSendBatch(netItem *batch, unsigned n) {
+    struct msghdr hdr[URING_DEPTH];
+    struct iovec  iov[URING_DEPTH];
+    unsigned      tail = *sqTail, head, done = 0, firstBad = n;
+
+    for (unsigned i = 0; i < n; i++) {
+        iov[i].iov_base = &batch[i].msg;
+        iov[i].iov_len  = sizeof(msgBuf);
+        memset(&hdr[i], 0, sizeof(hdr[i]));
+        hdr[i].msg_name    = &batch[i].to;
+        hdr[i].msg_namelen = sizeof(batch[i].to);
+        hdr[i].msg_iov     = &iov[i];
+        hdr[i].msg_iovlen  = 1;
+
+        unsigned idx = tail & *sqMask;
+        struct io_uring_sqe *sqe = &sqes[idx];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode    = IORING_OP_SENDMSG;
+        sqe->fd        = fixedFile ? 0 : sock;
+        sqe->flags     = fixedFile ? IOSQE_FIXED_FILE : 0;
+        if (i < n - 1)
+            sqe->flags |= IOSQE_IO_LINK;
+        sqe->addr      = (unsigned long) &hdr[i];
+        sqe->len       = 1;
+        sqe->user_data = i;
+        sqArray[idx]   = idx;
+        tail++;
+    }
+    __atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+
+    unsigned submitted = 0;
+    while (submitted < n) {
+        int r = uringEnter(n - submitted, 0, 0);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0) {
+            // The rest was not consumed: take it back and use sendto()
+            __atomic_store_n(sqTail, tail - (n - submitted), __ATOMIC_RELEASE);
+            firstBad = submitted;
+            break;
+        }
+        submitted += r;
+    }
+
+    head = *cqHead;
+    while (done < submitted) {
+        if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+            if (uringEnter(0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+                unix_error("io_uring_enter failed");
+            continue;
+        }
+        struct io_uring_cqe *cqe = &cqes[head & *cqMask];
+        if (cqe->res < 0 && cqe->user_data < firstBad)
+            firstBad = (unsigned) cqe->user_data;
+        head++;
+        done++;
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+    }
+
+    for (unsigned i = firstBad; i < n; i++)
+        sendto(sock, &batch[i].msg, sizeof(msgBuf), 0, (SA*)&batch[i].to, sizeof(batch[i].to));
+}
+
+static void* senderThread(void* arg) {
+    netItem  batch[URING_DEPTH];
+    unsigned max = (sqEntries < URING_DEPTH) ? sqEntries : URING_DEPTH;
+
+    while (1) {
+        pthread_mutex_lock(&qMutex);
+        while (qCount == 0 && !stopping)
+            pthread_cond_wait(&qNotEmpty, &qMutex);
+        if (qCount == 0) {
+            pthread_mutex_unlock(&qMutex);
+            break;
+        }
+        unsigned n = (qCount < max) ? qCount : max;
+        for (unsigned i = 0; i < n; i++)
+            batch[i] = queue[(qHead + i) % NETQ_SLOTS];
+        qHead = (qHead + n) % NETQ_SLOTS;
+        qCount -= n;
+        pthread_cond_broadcast(&qNotFull);
+        pthread_mutex_unlock(&qMutex);
+
+        uringSendBatch(batch, n);
+
+        pthread_mutex_lock(&qMutex);
+        sent += n;
+        pthread_cond_broadcast(&qDrained);
+        pthread_mutex_unlock(&qMutex);
+    }
+    return NULL;
+}
+
+/*--------------------------------------------------------------------
+   Public interface
+----------------------------------------------------------------------*/
+netBackend_t netInit(int sd, netBackend_t want) {
+    sock = sd;
+    backend = NET_SOCKETS;
+
+    if (want == NET_URING) {
+        int err = uringOpen();
+        if (err == 0) {
+            backend = NET_URING;
+            stopping = 0;
+            Pthread_create(&senderTid, NULL, senderThread, NULL);
+        }
+        else
+            fprintf(stderr, "io_uring is not available (%s); using the sockets backend\n",
+                    strerror(err));
+    }
+    return backend;
+}
+
+int netParseBackend(const char *name, netBackend_t *out) {
+    if (strcmp(name, "sockets") == 0)
+        *out = NET_SOCKETS;
+    else if (strcmp(name, "uring") == 0)
+        *out = NET_URING;
+    else
+        return -1;
+    return 0;
+}
+
+const char *netBackendName(netBackend_t b) {
+    return (b == NET_URING) ? "uring" : "sockets";
+}
+
+void netSend(const msgBuf *m, const struct sockaddr_in *to) {
+    captureMsg(1, m, to);
+
+    if (backend == NET_SOCKETS) {
+        sendto(sock, m, sizeof(*m), 0, (const SA*)to, sizeof(*to));
+        return;
+    }
+
+    pthread_mutex_lock(&qMutex);
+    while (qCount == NETQ_SLOTS)
+        pthread_cond_wait(&qNotFull, &qMutex);
+    queue[(qHead + qCount) % NETQ_SLOTS].msg = *m;
+    queue[(qHead + qCount) % NETQ_SLOTS].to  = *to;
+    qCount++;
+    queued++;
+    pthread_cond_signal(&qNotEmpty);
+    pthread_mutex_unlock(&qMutex);
+}
+
+void netFlush(void) {
+    if (backend == NET_SOCKETS)
+        return;
+
+    pthread_mutex_lock(&qMutex);
+    unsigned long target = queued;
+    while (sent < target)
+        pthread_cond_wait(&qDrained, &qMutex);
+    pthread_mutex_unlock(&qMutex);
+}
+
+void netShutdown(void) {
+    if (backend == NET_URING) {
+        pthread_mutex_lock(&qMutex);
+        stopping = 1;
+        pthread_cond_signal(&qNotEmpty);
+        pthread_mutex_unlock(&qMutex);
+        Pthread_join(senderTid, NULL);
+        uringClose();
+    }
+    backend = NET_SOCKETS;
+}
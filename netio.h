@@ -0,0 +1,33 @@
+//---------------------------------------------------------------------
+// Assignment : PA-04 Multi-Threaded UDP Server
+// Date       :
+// Author     : Joshua Cassada and Thomas Cantrell
+//
+// Outbound message path for the FACTORY server.
+// Sub-factory threads hand their messages to netSend() instead of
+// calling sendto() themselves.  The selected backend then either sends
+// them immediately (NET_SOCKETS) or queues them for a single sender
+// thread that submits them to the kernel in batches through io_uring
+// (NET_URING).
+//----------------------------------------------------------------------
+
+#ifndef  NETIO_H
+#define  NETIO_H
+
+#include <netinet/in.h>
+#include "message.h"
+
+typedef enum
+{
+    NET_SOCKETS = 0 , NET_URING
+} netBackend_t ;
+
+netBackend_t  netInit( int sd , netBackend_t want ) ;  /* returns the backend actually in use */
+int           netParseBackend( const char *name , netBackend_t *out ) ;
+const char   *netBackendName( netBackend_t b ) ;
+
+void  netSend( const msgBuf *m , const struct sockaddr_in *to ) ;
+void  netFlush( void ) ;     /* block until every handed-off message was sent */
+void  netShutdown( void ) ;  /* stop the sender thread; netInit() may be called again */
+
+#endif
@@ -0,0 +1,132 @@
+//---------------------------------------------------------------------
+// Assignment : PA-04 Multi-Threaded UDP Server
+// Date       :
+// Author     : Joshua Cassada and Thomas Cantrell
+//
+// Procurement client library.  See procure.h
+//----------------------------------------------------------------------
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "procure.h"
+#include "trace.h"
+
+typedef struct sockaddr SA;
+
+// Close the socket without losing the errno that made us give up
+static int fail(int sd, int code) {
+    int saved = errno;
+    close(sd);
+    errno = saved;
+    return code;
+}
+
+int procureOrder(const char *serverIP, unsigned short port, unsigned orderSize,
+                 const procureHandlers *h, procureSummary *sum) {
+    struct sockaddr_in myAddr, serverAddr;
+    socklen_t len;
+    msgBuf msg;
+
+    memset(sum, 0, sizeof(*sum));
+    sum->orderSize = orderSize;
+
+    int sd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sd < 0)
+        return PROCURE_SYSERR;
+
+    memset(&myAddr, 0, sizeof(myAddr));
+    myAddr.sin_family = AF_INET;
+    myAddr.sin_addr.s_addr = htonl(INADDR_ANY);
+    myAddr.sin_port = htons(0);
+    if (bind(sd, (SA *)&myAddr, sizeof(myAddr)) < 0)
+        return fail(sd, PROCURE_SYSERR);
+
+    // Our port is the order ID the factory traces under as well
+    len = sizeof(myAddr);
+    getsockname(sd, (SA *)&myAddr, &len);
+    unsigned orderID = ntohs(myAddr.sin_port);
+    traceSocket(sd);
+
+    memset(&serverAddr, 0, sizeof(serverAddr));
+    serverAddr.sin_family = AF_INET;
+    serverAddr.sin_port = htons(port);
+    if (inet_pton(AF_INET, serverIP, &serverAddr.sin_addr) <= 0) {
+        errno = EINVAL;
+        return fail(sd, PROCURE_SYSERR);
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    msg.purpose = htonl(REQUEST_MSG);
+    msg.orderSize = htonl(orderSize);
+
+    long long requested = traceNow();
+    if (sendto(sd, &msg, sizeof(msg), 0, (SA *)&serverAddr, sizeof(serverAddr)) < 0)
+        return fail(sd, PROCURE_SYSERR);
+
+    len = sizeof(serverAddr);
+    memset(&msg, 0, sizeof(msg));
+    if (recvfrom(sd, &msg, sizeof(msg), 0, (SA *)&serverAddr, &len) < 0)
+        return fail(sd, PROCURE_SYSERR);
+    traceSpan("confirm_wait", orderID, requested, traceNow());
+
+    if (ntohl(msg.purpose) != ORDR_CONFIRM)
+        return fail(sd, PROCURE_PROTOCOL);
+
+    sum->numFac = ntohl(msg.numFac);
+    sum->orderSize = ntohl(msg.orderSize);
+    if (sum->numFac > MAXFACTORIES)
+        return fail(sd, PROCURE_PROTOCOL);
+    if (h != NULL && h->confirmed != NULL)
+        h->confirmed(sum->numFac, h->ctx);
+
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+
+    unsigned activeFactories = sum->numFac;
+    while (activeFactories > 0) {
+        memset(&msg, 0, sizeof(msg));
+        if (recvfrom(sd, &msg, sizeof(msg), 0, (SA *)&serverAddr, &len) < 0)
+            return fail(sd, PROCURE_SYSERR);
+        traceSpan("deliver", orderID, traceArrival(sd), traceNow());
+
+        procureIncrement inc;
+        inc.facID = ntohl(msg.facID);
+        inc.partsMade = ntohl(msg.partsMade);
+        inc.duration = ntohl(msg.duration);
+
+        switch (ntohl(msg.purpose)) {
+            case PRODUCTION_MSG:
+                if (inc.facID < 1 || inc.facID > sum->numFac)
+                    break;
+                sum->iters[inc.facID]++;
+                sum->partsMade[inc.facID] += inc.partsMade;
+                sum->totalParts += inc.partsMade;
+                if (h != NULL && h->parts != NULL)
+                    h->parts(&inc, h->ctx);
+                break;
+
+            case COMPLETION_MSG:
+                activeFactories--;
+                break;
+
+            case PROTOCOL_ERR:
+                return fail(sd, PROCURE_PROTOCOL);
+        }
+    }
+
+    gettimeofday(&end, NULL);
+    sum->elapsedMs = (end.tv_sec - start.tv_sec) * 1000.0 +
+                     (end.tv_usec - start.tv_usec) / 1000.0;
+    traceSpan("order", orderID, requested, traceNow());
+
+    close(sd);
+    return PROCURE_OK;
+}
@@ -0,0 +1,44 @@
+//---------------------------------------------------------------------
+// Assignment : PA-04 Multi-Threaded UDP Server
+// Date       :
+// Author     : Joshua Cassada and Thomas Cantrell
+//
+// Procurement client library.
+// procureOrder() places one order with a FACTORY server and streams
+// every batch of parts to the caller as soon as its PRODUCTION_MSG
+// arrives, then fills in the per sub-factory totals once every
+// sub-factory has sent its COMPLETION_MSG.
+//----------------------------------------------------------------------
+
+#ifndef  PROCURE_H
+#define  PROCURE_H
+
+#include "message.h"
+
+#define PROCURE_OK          0
+#define PROCURE_SYSERR    (-1)    /* a system call failed; errno says why */
+#define PROCURE_PROTOCOL  (-2)    /* the factory sent PROTOCOL_ERR */
+
+typedef struct {
+    unsigned  facID ,       /* which sub-factory made them */
+              partsMade ,   /* #of parts in this batch */
+              duration ;    /* how long it took to make them ( mSec ) */
+} procureIncrement ;
+
+typedef struct {
+    void  (*confirmed)( unsigned numFac , void *ctx ) ;            /* may be NULL */
+    void  (*parts)( const procureIncrement *inc , void *ctx ) ;     /* may be NULL */
+    void   *ctx ;
+} procureHandlers ;
+
+typedef struct {
+    unsigned  orderSize , numFac , totalParts ;
+    unsigned  partsMade[ MAXFACTORIES + 1 ] ,   /* indexed by facID */
+              iters[ MAXFACTORIES + 1 ] ;
+    double    elapsedMs ;                       /* confirmation to last completion */
+} procureSummary ;
+
+int  procureOrder( const char *serverIP , unsigned short port , unsigned orderSize ,
+                   const procureHandlers *h , procureSummary *sum ) ;
+
+#endif
@@ -1,162 +1,101 @@
 #include <sys/types.h>
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <arpa/inet.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
 #include <stdlib.h>
-#include <signal.h>
-#include <time.h>
-#include <sys/stat.h>
-#include <sys/wait.h>
 
 #include "wrappers.h"
 #include "message.h"
+#include "procure.h"
+#include "trace.h"
 
-#define MAXFACTORIES    20
+typedef struct {
+    FILE *report;          // where the human-readable report goes
+    FILE *stream;          // newline-delimited JSON increments, or NULL
+    char *myName;
+} procurementCtx;
 
-typedef struct sockaddr SA;
+static void onConfirmed(unsigned numFac, void *arg) {
+    procurementCtx *ctx = arg;
 
-int main(int argc, char *argv[]) {
-    int numFactories,      // Total Number of Factory Threads
-        activeFactories,   // How many are still alive and manufacturing parts
-        iters[MAXFACTORIES+1] = {0},  // num Iterations completed by each Factory
-        partsMade[MAXFACTORIES+1] = {0}, 
-        totalItems = 0;
-
-    char *myName = "Joshua Cassada and Thomas Cantrell"; 
-    printf("\nThis is PROCUREMENT. ( by %s )\n\n", myName);    
-
-    
-    
-    
-    if (argc < 4) {
-        printf("PROCUREMENT Usage: %s  <order_size> <FactoryServerIP>  <port>\n", argv[0]);
-        exit(-1);
-    }
-
-    unsigned orderSize = atoi(argv[1]);
-    char *serverIP = argv[2];
-    unsigned short port = (unsigned short) atoi(argv[3]);
- 
-    struct sockaddr_in myAddr, serverAddr;
-    int sd = socket(AF_INET, SOCK_DGRAM, 0);
-    if (sd < 0) {
-        perror("Socket creation failed");
-        exit(EXIT_FAILURE);
-    }
+    fprintf(ctx->report, "PROCUREMENT ( by %s ) received this from the FACTORY server: "
+            "{ ORDR_CNFRM , numFacThrds=%-3d }\n\n", ctx->myName, numFac);
+    fflush(ctx->report);
+}
 
-    memset((void *) &myAddr, 0, sizeof(myAddr));
-    myAddr.sin_family = AF_INET;
-    myAddr.sin_addr.s_addr = htonl(INADDR_ANY);
-    myAddr.sin_port = htons(0);
+// One line per PRODUCTION_MSG, flushed at once so a reader on a pipe
+// can use the parts as soon as they are made
+static void onParts(const procureIncrement *inc, void *arg) {
+    procurementCtx *ctx = arg;
 
-    if (bind(sd, (const struct sockaddr *)&myAddr, sizeof(myAddr)) < 0) {
-        perror("bind failed");
-        close(sd);
-        exit(EXIT_FAILURE);
-    }
-
-    memset((void *) &serverAddr, 0, sizeof(serverAddr));
-    serverAddr.sin_family = AF_INET;
-    serverAddr.sin_port = htons(port);
-    if (inet_pton(AF_INET, serverIP, &serverAddr.sin_addr) <= 0) {
-        perror("Invalid server IP address");
-        close(sd);
-        exit(EXIT_FAILURE);
-    }
+    fprintf(ctx->stream, "{\"facID\":%u,\"partsMade\":%u,\"duration\":%u}\n",
+            inc->facID, inc->partsMade, inc->duration);
+    fflush(ctx->stream);
+}
 
-    printf("\nAttempting Factory server at '%s' : %d\n", serverIP, port);
-
-    msgBuf msg1;
-    memset(&msg1, 0, sizeof(msg1));
-    msg1.purpose = htonl(REQUEST_MSG);
-    msg1.orderSize = htonl(orderSize);
-    
-    if (sendto(sd, &msg1, sizeof(msg1), 0, (SA *)&serverAddr, sizeof(serverAddr)) < 0) {
-        perror("sendto failed");
-        close(sd);
-        exit(EXIT_FAILURE);
+int main(int argc, char *argv[]) {
+    procurementCtx ctx = { stdout, NULL, "Joshua Cassada and Thomas Cantrell" };
+    int opt;
+
+    while ((opt = getopt(argc, argv, "T:S:")) != -1) {
+        if (opt == 'T')
+            traceOpen(optarg, "procurement");
+        else if (opt == 'S' && strcmp(optarg, "-") == 0) {
+            ctx.stream = stdout;
+            ctx.report = stderr;
+        }
+        else if (opt == 'S') {
+            if ((ctx.stream = fopen(optarg, "w")) == NULL)
+                err_sys("Failed to open the stream file");
+        }
+        else {
+            argc = 0;
+            break;
+        }
     }
 
-    printf("\nPROCUREMENT Sent this message to the FACTORY server: ");
-    printMsg(&msg1);
-    puts("");
-
-    msgBuf msg2;
-    memset(&msg2, 0, sizeof(msg2));
-    printf("\nPROCUREMENT is now waiting for order confirmation ...\n");
+    fprintf(ctx.report, "\nThis is PROCUREMENT. ( by %s )\n\n", ctx.myName);
 
-    socklen_t len = sizeof(serverAddr);
-    if (recvfrom(sd, &msg2, sizeof(msg2), 0, (SA *)&serverAddr, &len) < 0) {
-        perror("recvfrom failed");
-        close(sd);
-        exit(EXIT_FAILURE);
+    if (argc - optind < 3) {
+        fprintf(ctx.report, "PROCUREMENT Usage: %s [-T traceFile] [-S streamFile|-] <order_size> <FactoryServerIP>  <port>\n", argv[0]);
+        exit(-1);
     }
 
-    printf("PROCUREMENT ( by %s ) received this from the FACTORY server: ", myName);
-    printMsg(&msg2);
-    puts("\n");
+    unsigned orderSize = atoi(argv[optind]);
+    char *serverIP = argv[optind + 1];
+    unsigned short port = (unsigned short) atoi(argv[optind + 2]);
 
-    numFactories = ntohl(msg2.numFac);
-    orderSize = ntohl(msg2.orderSize);  
-    activeFactories = numFactories;
-    struct timeval start, end;
-    gettimeofday(&start, NULL);
+    fprintf(ctx.report, "\nAttempting Factory server at '%s' : %d\n", serverIP, port);
+    fprintf(ctx.report, "\nPROCUREMENT Sending this message to the FACTORY server: { REQUEST    , OrderSz=%-3d }\n", orderSize);
+    fprintf(ctx.report, "\nPROCUREMENT is now waiting for order confirmation ...\n");
+    fflush(ctx.report);
 
-    while (activeFactories > 0) {
-        msgBuf msg;
-        memset(&msg, 0, sizeof(msg));
+    procureHandlers handlers = { onConfirmed, ctx.stream ? onParts : NULL, &ctx };
+    procureSummary  sum;
 
-        if (recvfrom(sd, &msg, sizeof(msg), 0, (SA *)&serverAddr, &len) < 0) {
-            err_sys("recvfrom failed");
-        }
-
-        msgPurpose_t purpose = ntohl(msg.purpose);
-        unsigned facID = ntohl(msg.facID);
-        unsigned capacity = ntohl(msg.capacity);
-        unsigned partsMadeNow = ntohl(msg.partsMade);
-        unsigned duration = ntohl(msg.duration);
-
-        if (purpose == PRODUCTION_MSG) {
-            iters[facID]++;
-            partsMade[facID] += partsMadeNow;
-            printf("PROCUREMENT ( by %s ): Factory #%d produced %d parts in %d milliSecs\n",
-               myName, facID, partsMadeNow, duration);
-        } 
-        else if (purpose == COMPLETION_MSG) {
-            activeFactories--;
-            printf("PROCUREMENT ( by %s ): Factory #%d COMPLETED its task\n", 
-                   myName, facID);
-        }
-        else if (purpose == PROTOCOL_ERR){
-            printf("PROCUREMENT: Received { PROTOCOL_ERROR }\n");
-            close(sd);
+    switch (procureOrder(serverIP, port, orderSize, &handlers, &sum)) {
+        case PROCURE_SYSERR:
+            err_sys("PROCUREMENT failed");
+        case PROCURE_PROTOCOL:
+            fprintf(ctx.report, "PROCUREMENT: Received { PROTOCOL_ERROR }\n");
             exit(1);
-        }
     }
 
-    gettimeofday(&end, NULL);
-    double elapsed = (end.tv_sec - start.tv_sec) * 1000.0 +
-                    (end.tv_usec - start.tv_usec) / 1000.0;
-
-    totalItems = 0;
-    printf("\n****** PROCUREMENT ( by %s ) Summary Report ******\n", myName);
-    printf("Sub-Factory      Parts Made      Iterations\n");
+    fprintf(ctx.report, "\n****** PROCUREMENT ( by %s ) Summary Report ******\n", ctx.myName);
+    fprintf(ctx.report, "Sub-Factory      Parts Made      Iterations\n");
 
-    for (int i = 1; i <= numFactories; i++) {
-        printf("     %d             %2d              %d\n", 
-               i, partsMade[i], iters[i]);
-        totalItems += partsMade[i];
+    for (unsigned i = 1; i <= sum.numFac; i++) {
+        fprintf(ctx.report, "     %d             %2d              %d\n",
+                i, sum.partsMade[i], sum.iters[i]);
     }
 
-    printf("============================================\n");
-    printf("Grand total parts made  =  %d  vs  order size of   %d\n", 
-           totalItems, orderSize);
-    printf("Order-to-Completion time = %.1f milliseconds\n\n", elapsed);
+    fprintf(ctx.report, "============================================\n");
+    fprintf(ctx.report, "Grand total parts made  =  %d  vs  order size of   %d\n",
+            sum.totalParts, sum.orderSize);
+    fprintf(ctx.report, "Order-to-Completion time = %.1f milliseconds\n\n", sum.elapsedMs);
 
-    close(sd);
+    if (ctx.stream != NULL && ctx.stream != stdout)
+        fclose(ctx.stream);
     return 0;
-}
\ No newline at end of file
+}
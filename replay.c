@@ -0,0 +1,188 @@
+//---------------------------------------------------------------------
+// Assignment : PA-04 Multi-Threaded UDP Server
+// Date       :
+// Author     : Joshua Cassada and Thomas Cantrell
+//
+// REPLAY: re-send the orders of a FACTORY capture ( factory -w ) to a
+// server and compare what comes back with what was recorded.
+// Orders are replayed one at a time, at their recorded arrival times
+// divided by the speedup.  Run the server with the same -s / -p
+// settings as the captured run for the results to be comparable.
+// Which sub-factory makes which parts, and so how many PRODUCTION
+// messages an order takes, depends on which thread gets the order lock
+// first.  Only numFac and the total parts are compared; the message
+// count is shown for information.
+// An order also fails to match if it took longer than its recorded time,
+// scaled from the captured server's -x to this replay's -x, plus the
+// tolerance ( -t, percent ).  Give the server the same -x as the replay.
+//----------------------------------------------------------------------
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+
+#include "wrappers.h"
+#include "message.h"
+#include "capture.h"
+
+#define REPLY_TIMEOUT   10   /* seconds to wait for any one reply */
+#define TIME_SLACK_MS    1.0 /* absolute slack on top of the tolerance */
+
+typedef struct sockaddr SA;
+
+typedef struct {
+    unsigned numFac, msgs, parts;
+    double   ms;
+    int      error;
+} orderResult;
+
+static int samePeer(const struct sockaddr_in *a, const struct sockaddr_in *b) {
+    return a->sin_addr.s_addr == b->sin_addr.s_addr && a->sin_port == b->sin_port;
+}
+
+static void tally(orderResult *r, const msgBuf *m) {
+    r->msgs++;
+    r->parts += ntohl(m->partsMade);
+}
+
+// What the server sent back for the request at trace[req]
+static void recorded(captureRec *trace, int n, int req, orderResult *r) {
+    unsigned done = 0;
+
+    memset(r, 0, sizeof(*r));
+    for (int i = req + 1; i < n; i++) {
+        captureRec *c = &trace[i];
+        if (!c->out || !samePeer(&c->peer, &trace[req].peer))
+            continue;
+
+        switch (ntohl(c->msg.purpose)) {
+            case ORDR_CONFIRM:   r->numFac = ntohl(c->msg.numFac); break;
+            case PRODUCTION_MSG: tally(r, &c->msg); break;
+            case COMPLETION_MSG: done++; break;
+            case PROTOCOL_ERR:   r->error = 1; break;
+        }
+        if (r->error || (r->numFac > 0 && done == r->numFac)) {
+            r->ms = (c->usec - trace[req].usec) / 1000.0;
+            return;
+        }
+    }
+    r->error = 1;
+}
+
+// Send one order to the server and collect its replies
+static void replayOrder(const struct sockaddr_in *server, unsigned orderSize, orderResult *r) {
+    struct timeval tmo = { REPLY_TIMEOUT, 0 };
+    unsigned done = 0;
+    msgBuf msg;
+    int sd;
+
+    memset(r, 0, sizeof(*r));
+    if ((sd = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+        err_sys("socket failed");
+    setsockopt(sd, SOL_SOCKET, SO_RCVTIMEO, &tmo, sizeof(tmo));
+
+    memset(&msg, 0, sizeof(msg));
+    msg.purpose = htonl(REQUEST_MSG);
+    msg.orderSize = htonl(orderSize);
+    double start = nowMs();
+    if (sendto(sd, &msg, sizeof(msg), 0, (const SA*)server, sizeof(*server)) < 0)
+        err_sys("sendto failed");
+
+    while (!r->error && (r->numFac == 0 || done < r->numFac)) {
+        if (recvfrom(sd, &msg, sizeof(msg), 0, NULL, NULL) < 0) {
+            r->error = 1;
+            break;
+        }
+        switch (ntohl(msg.purpose)) {
+            case ORDR_CONFIRM:   r->numFac = ntohl(msg.numFac); r->error = (r->numFac == 0); break;
+            case PRODUCTION_MSG: tally(r, &msg); break;
+            case COMPLETION_MSG: done++; break;
+            case PROTOCOL_ERR:   r->error = 1; break;
+        }
+    }
+    r->ms = nowMs() - start;
+    close(sd);
+}
+
+int main(int argc, char *argv[]) {
+    double speedup = 1.0, tolerance = 25.0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "x:t:")) != -1) {
+        if (opt == 'x' && (speedup = atof(optarg)) > 0)
+            continue;
+        if (opt == 't' && (tolerance = atof(optarg)) >= 0)
+            continue;
+        argc = 0;
+        break;
+    }
+    if (argc - optind != 3) {
+        printf("REPLAY Usage: %s [-x speedup] [-t tolerance%%] <captureFile> <FactoryServerIP> <port>\n", argv[0]);
+        exit(-1);
+    }
+
+    FILE *fp = fopen(argv[optind], "r");
+    if (fp == NULL)
+        err_sys("Failed to open the capture file");
+
+    int n = 0, cap = 256;
+    captureRec *trace = malloc(cap * sizeof(captureRec));
+    double recSpeedup = 1.0;
+    while (trace != NULL && captureRead(fp, &trace[n], &recSpeedup)) {
+        if (++n == cap)
+            trace = realloc(trace, (cap *= 2) * sizeof(captureRec));
+    }
+    fclose(fp);
+    if (trace == NULL)
+        err_quit("Out of memory reading the capture\n");
+
+    struct sockaddr_in server;
+    memset(&server, 0, sizeof(server));
+    server.sin_family = AF_INET;
+    server.sin_port = htons(atoi(argv[optind + 2]));
+    if (inet_pton(AF_INET, argv[optind + 1], &server.sin_addr) <= 0)
+        err_quit("Invalid server IP address\n");
+
+    printf("\nREPLAY of '%s' against %s : %d at %.1fx speed, %.0f%% time tolerance\n\n",
+           argv[optind], argv[optind + 1], ntohs(server.sin_port), speedup, tolerance);
+    printf("Order  OrderSize    numFac       Parts        Messages       Time (ms)        Match\n");
+    printf("                   rec / rep   rec / rep  rec / rep (info)  rec  /  rep\n");
+
+    int orders = 0, mismatches = 0;
+    double start = nowMs();
+    for (int i = 0; i < n; i++) {
+        if (trace[i].out || ntohl(trace[i].msg.purpose) != REQUEST_MSG)
+            continue;
+
+        double wait = trace[i].usec / 1000.0 * recSpeedup / speedup - (nowMs() - start);
+        if (wait > 0)
+            usleep((useconds_t)(wait * 1000));
+
+        orderResult rec, rep;
+        recorded(trace, n, i, &rec);
+        replayOrder(&server, ntohl(trace[i].msg.orderSize), &rep);
+
+        int same = !rec.error && !rep.error && rec.numFac == rep.numFac &&
+                   rec.parts == rep.parts;
+        double expected = rec.ms * recSpeedup / speedup;
+        int slow = rep.ms > expected * (1 + tolerance / 100) + TIME_SLACK_MS;
+        int match = same && !slow;
+        mismatches += !match;
+
+        printf("%4d   %7d     %3d / %-3d  %5d / %-5d  %4d / %-4d  %7.1f / %-7.1f   %s\n",
+               ++orders, ntohl(trace[i].msg.orderSize), rec.numFac, rep.numFac,
+               rec.parts, rep.parts, rec.msgs, rep.msgs, rec.ms, rep.ms,
+               match ? "yes" : (rep.error ? "ERROR" : (same ? "SLOW" : "NO")));
+    }
+
+    printf("============================================\n");
+    printf("Replayed %d orders in %.1f milliseconds, %d did not match the capture\n\n",
+           orders, nowMs() - start, mismatches);
+    free(trace);
+    return mismatches ? 1 : 0;
+}
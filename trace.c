@@ -0,0 +1,123 @@
+//---------------------------------------------------------------------
+// Assignment : PA-04 Multi-Threaded UDP Server
+// Date       :
+// Author     : Joshua Cassada and Thomas Cantrell
+//
+// Optional per-order tracing.  See trace.h
+//----------------------------------------------------------------------
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/sockios.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include "wrappers.h"
+#include "trace.h"
+
+#define TRACE_BUF   256   /* spans a thread keeps before writing them out */
+
+typedef struct {
+    const char *name;
+    unsigned    order;
+    long long   start, end;
+} traceEvent;
+
+static FILE            *traceFile = NULL;
+static int              traceOn = 0;
+static pthread_mutex_t  traceMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static __thread traceEvent events[TRACE_BUF];
+static __thread int        numEvents = 0;
+static __thread pid_t      myTid = 0;
+
+void traceOpen(const char *path, const char *procName) {
+    if ((traceFile = fopen(path, "w")) == NULL)
+        err_sys("Failed to open the trace file");
+
+    fprintf(traceFile, "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"%s\"}}",
+            getpid(), procName);
+    traceOn = 1;
+    atexit(traceClose);
+}
+
+void traceThreadDone(void) {
+    if (!traceOn || numEvents == 0)
+        return;
+
+    if (myTid == 0)
+        myTid = (pid_t) syscall(SYS_gettid);
+
+    pthread_mutex_lock(&traceMutex);
+    for (int i = 0; traceFile != NULL && i < numEvents; i++) {
+        traceEvent *e = &events[i];
+        fprintf(traceFile, ",\n{\"name\":\"%s\",\"cat\":\"order\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,"
+                "\"pid\":%d,\"tid\":%d,\"args\":{\"order\":%u}}",
+                e->name, e->start, e->end - e->start,
+                getpid(), myTid, e->order);
+    }
+    pthread_mutex_unlock(&traceMutex);
+    numEvents = 0;
+}
+
+void traceClose(void) {
+    if (!traceOn)
+        return;
+
+    traceThreadDone();
+    pthread_mutex_lock(&traceMutex);
+    traceOn = 0;
+    fprintf(traceFile, "\n]\n");
+    fclose(traceFile);
+    traceFile = NULL;
+    pthread_mutex_unlock(&traceMutex);
+}
+
+long long traceNow(void) {
+    return traceOn ? (long long)(nowMs() * 1000) : 0;
+}
+
+// SIOCGSTAMP turns on receive timestamps the first time it is used on a
+// socket ( and fails with ENOENT, as nothing was stamped yet ).  Do not
+// also set SO_TIMESTAMP: with it on, the kernel stops keeping the stamp
+// SIOCGSTAMP reads.
+void traceSocket(int sd) {
+    struct timeval tv;
+
+    if (traceOn)
+        ioctl(sd, SIOCGSTAMP, &tv);
+}
+
+// The kernel stamps arrivals with the wall clock; move that onto the
+// monotonic clock the spans use.  Returns 0 if there is no stamp, and
+// traceSpan() drops spans that start at 0.
+long long traceArrival(int sd) {
+    struct timeval tv;
+
+    if (!traceOn || ioctl(sd, SIOCGSTAMP, &tv) < 0)
+        return 0;
+
+    struct timeval wall;
+    gettimeofday(&wall, NULL);
+    long long mono = traceNow();
+    long long ago = (wall.tv_sec - tv.tv_sec) * 1000000LL + (wall.tv_usec - tv.tv_usec);
+    return (ago > 0) ? mono - ago : mono;
+}
+
+void traceSpan(const char *name, unsigned order, long long start, long long end) {
+    if (!traceOn || start <= 0)
+        return;
+
+    traceEvent *e = &events[numEvents++];
+    e->name = name;
+    e->order = order;
+    e->start = (start < end) ? start : end;   /* clock conversion jitter */
+    e->end = end;
+    if (numEvents == TRACE_BUF)
+        traceThreadDone();
+}
@@ -0,0 +1,31 @@
+//---------------------------------------------------------------------
+// Assignment : PA-04 Multi-Threaded UDP Server
+// Date       :
+// Author     : Joshua Cassada and Thomas Cantrell
+//
+// Optional per-order tracing for FACTORY and PROCUREMENT.
+// Spans are timed with CLOCK_MONOTONIC, kept in a per-thread buffer,
+// and written as Chrome trace-event JSON ( chrome://tracing, Perfetto ).
+// Every span carries the order ID, which is the procurement client's
+// UDP port, so both sides of one order can be matched.  Both programs
+// use the same clock, so their files can be merged with
+//     jq -s add factory.json procurement.json > order.json
+//
+// When tracing is off, traceNow() returns 0 and traceSpan() returns
+// at once.
+//----------------------------------------------------------------------
+
+#ifndef  TRACE_H
+#define  TRACE_H
+
+void       traceOpen( const char *path , const char *procName ) ;
+void       traceClose( void ) ;
+
+long long  traceNow( void ) ;                      /* usec, 0 if tracing is off */
+long long  traceArrival( int sd ) ;                /* when the last datagram read from sd arrived, 0 if unknown */
+void       traceSocket( int sd ) ;                 /* ask the kernel to timestamp arrivals on sd */
+
+void       traceSpan( const char *name , unsigned order , long long start , long long end ) ;  /* start 0: dropped */
+void       traceThreadDone( void ) ;               /* flush the calling thread's buffer */
+
+#endif
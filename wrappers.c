@@ -70,6 +70,18 @@ int Usleep( useconds_t usec )
 	}
 }
 
+/************************************************
+ * The monotonic clock, in milliseconds.  Shared by
+ * everything that times orders, spans or benchmarks
+ ************************************************/
+double nowMs( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC , &ts );
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6 ;
+}
+
 /************************************************
  * Wrapper for sigaction() 
   ***********************************************/
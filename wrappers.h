@@ -13,6 +13,7 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <sys/time.h>   
+#include <time.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <semaphore.h>
@@ -30,6 +31,7 @@ void    posix_error( int code, char *msg) ;
 
 pid_t   Fork(void);
 int     Usleep( useconds_t usec );
+double  nowMs( void ) ;     /* CLOCK_MONOTONIC, in milliseconds */
 
 typedef void Sigfunc( int ) ;
 Sigfunc * sigactionWrapper( int signo, Sigfunc *func ) ;